@@ -6,125 +6,142 @@
 #include <sys/socket.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
+
+#include "transfer.h"
 
 #define PORT 8080
 #define BUFFER_SIZE 1024
 #define MAX_COMMAND_LENGTH 100
+#define SERVER_ADDRESS "127.0.0.1"
 
-// Handle file upload to server
-void handle_upload(int sock, const char *filename)
+// Report finished background transfers. ctx is the prompt to redraw, or
+// NULL in batch mode where nobody is typing.
+static void on_transfer_complete(const Transfer *transfer, void *ctx)
 {
-    char buffer[BUFFER_SIZE];
+    const char *prompt = ctx;
+    printf("%s[#%d] %s %s %s: %s\n", prompt ? "\n" : "", transfer->id,
+           transfer->type == TRANSFER_UPLOAD ? "UPLOAD" : "DOWNLOAD",
+           transfer->filename,
+           transfer->state == TRANSFER_DONE ? "done" : "failed",
+           transfer->message);
+    if (prompt)
+        printf("%s> ", prompt);
+    fflush(stdout);
+}
 
-    // Open file
-    int file_fd = open(filename, O_RDONLY);
-    if (file_fd < 0)
-    {
-        printf("Error: Cannot open file %s\n", filename);
-        send(sock, "END_OF_UPLOAD", 13, 0);
-        return;
-    }
+// Pull one line out of stdin without blocking the event loop. Only calls
+// read() when can_read is set. Returns 1 for a line, 0 if none is complete
+// yet, -1 on EOF.
+static int read_command(char *command, size_t size, int can_read)
+{
+    static char pending[BUFFER_SIZE];
+    static size_t pending_len = 0;
+    static int at_eof = 0;
 
-    // Wait for server ready signal
-    memset(buffer, 0, sizeof(buffer));
-    ssize_t recv_len = recv(sock, buffer, sizeof(buffer), 0);
-    if (recv_len <= 0 || strstr(buffer, "READY_FOR_UPLOAD") == NULL)
+    char *newline = memchr(pending, '\n', pending_len);
+    if (!newline && can_read && !at_eof)
     {
-        printf("Server not ready for upload or error occurred\n");
-        close(file_fd);
-        return;
+        ssize_t bytes = read(STDIN_FILENO, pending + pending_len,
+                             sizeof(pending) - pending_len);
+        if (bytes <= 0)
+            at_eof = 1;
+        else
+            pending_len += bytes;
+        newline = memchr(pending, '\n', pending_len);
     }
 
-    // Send file in chunks
-    ssize_t bytes_read;
-    size_t total_sent = 0;
-    while ((bytes_read = read(file_fd, buffer, sizeof(buffer))) > 0)
+    if (!newline)
     {
-        ssize_t bytes_sent = send(sock, buffer, bytes_read, 0);
-        if (bytes_sent > 0)
-        {
-            total_sent += bytes_sent;
-        }
-        usleep(1000); // Small delay to prevent network congestion
+        if (pending_len == 0 && at_eof)
+            return -1;
+        if (pending_len < sizeof(pending) && !at_eof)
+            return 0;
+        newline = pending + pending_len;
     }
 
-    close(file_fd);
+    size_t line_len = newline - pending;
+    size_t copy_len = line_len < size - 1 ? line_len : size - 1;
+    memcpy(command, pending, copy_len);
+    command[copy_len] = '\0';
+
+    size_t consumed = line_len < pending_len ? line_len + 1 : pending_len;
+    memmove(pending, pending + consumed, pending_len - consumed);
+    pending_len -= consumed;
+    return 1;
+}
 
-    // Send end marker
-    send(sock, "END_OF_UPLOAD", 13, 0);
+// Drive the engine until every queued transfer has finished
+static void wait_for_transfers(TransferEngine *engine, int show_progress)
+{
+    struct timespec last, now;
+    clock_gettime(CLOCK_MONOTONIC, &last);
 
-    // Wait for server response
-    memset(buffer, 0, sizeof(buffer));
-    recv_len = recv(sock, buffer, sizeof(buffer) - 1, 0);
-    if (recv_len > 0)
+    while (transfer_engine_pending(engine) > 0)
     {
-        buffer[recv_len] = '\0';
-        printf("%s", buffer);
+        transfer_engine_step(engine, NULL, 0, 250);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (show_progress && now.tv_sec - last.tv_sec >= 1)
+        {
+            transfer_print_status(engine, stderr, 1);
+            last = now;
+        }
     }
 }
 
-// Handle file download from server
-void handle_download(int sock, const char *filename)
+// Print the reply to a control command while transfers keep running.
+// Stops after one read, or at END_OF_LIST when until_end_of_list is set.
+// Returns -1 if the server closed the connection.
+static int read_reply(TransferEngine *engine, int sock, int until_end_of_list)
 {
     char buffer[BUFFER_SIZE];
-    memset(buffer, 0, sizeof(buffer));
 
-    // Create/open local file
-    int file_fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (file_fd < 0)
-    {
-        printf("Error: Cannot create file %s\n", filename);
-        return;
-    }
+    // Completions land between reply chunks, so skip the prompt redraw
+    void *prompt = engine->ctx;
+    engine->ctx = NULL;
 
-    // Receive file in chunks
-    size_t total_received = 0;
+    int status = 0;
     while (1)
     {
-        memset(buffer, 0, sizeof(buffer));
-        ssize_t bytes_received = recv(sock, buffer, sizeof(buffer), 0);
-        if (bytes_received <= 0)
-        {
-            break;
-        }
-
-        // Check for error message
-        if (strncmp(buffer, "ERROR:", 6) == 0)
-        {
-            printf("%s", buffer);
-            close(file_fd);
-            remove(filename);
-            return;
-        }
+        if (!(transfer_engine_step(engine, &sock, 1, 250) & 1))
+            continue;
 
-        // Check for end of file marker
-        char *end_marker = strstr(buffer, "END_OF_FILE");
-        if (end_marker != NULL)
+        ssize_t bytes = recv(sock, buffer, sizeof(buffer) - 1, 0);
+        if (bytes <= 0)
         {
-            // Write only up to the end marker
-            ssize_t bytes_to_write = end_marker - buffer;
-            if (bytes_to_write > 0)
-            {
-                write(file_fd, buffer, bytes_to_write);
-                total_received += bytes_to_write;
-            }
+            status = -1;
             break;
         }
 
-        // Write to file
-        write(file_fd, buffer, bytes_received);
-        total_received += bytes_received;
+        buffer[bytes] = '\0';
+        printf("%s", buffer);
+        fflush(stdout);
+        if (!until_end_of_list || strstr(buffer, "END_OF_LIST"))
+            break;
     }
 
-    close(file_fd);
-    if (total_received > 0)
-    {
-        printf("File '%s' downloaded successfully (%zu bytes)\n", filename, total_received);
-    }
-    else
-    {
-        printf("Warning: File may be empty or transfer failed\n");
-    }
+    engine->ctx = prompt;
+    return status;
+}
+
+// Scripted bulk mode: run the transfers given on the command line and exit
+static int run_batch(TransferEngine *engine)
+{
+    engine->on_complete = on_transfer_complete;
+    engine->ctx = NULL;
+
+    wait_for_transfers(engine, 1);
+
+    printf("\nSummary:\n");
+    transfer_print_status(engine, stdout, 0);
+    return transfer_engine_failed(engine) > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s <username> [-j <jobs>] [UPLOAD <file> | DOWNLOAD <file>]...\n",
+            program);
 }
 
 int main(int argc, char *argv[])
@@ -132,7 +149,7 @@ int main(int argc, char *argv[])
     // Check command line arguments
     if (argc < 2)
     {
-        fprintf(stderr, "Usage: %s <username>\n", argv[0]);
+        print_usage(argv[0]);
         exit(EXIT_FAILURE);
     }
 
@@ -141,6 +158,59 @@ int main(int argc, char *argv[])
     strncpy(username, argv[1], sizeof(username) - 1);
     username[sizeof(username) - 1] = '\0';
 
+    TransferEngine engine;
+    int max_active = TRANSFER_DEFAULT_ACTIVE;
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            max_active = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "UPLOAD") == 0 || strcmp(argv[i], "DOWNLOAD") == 0) &&
+                 i + 1 < argc)
+        {
+            i++;
+        }
+        else
+        {
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (transfer_engine_init(&engine, SERVER_ADDRESS, PORT, username, max_active) < 0)
+    {
+        fprintf(stderr, "Invalid address\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Transfers on the command line mean batch mode, no interactive shell
+    int batch_jobs = 0;
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0)
+        {
+            i++;
+            continue;
+        }
+        TransferType type = strcmp(argv[i], "UPLOAD") == 0 ? TRANSFER_UPLOAD
+                                                           : TRANSFER_DOWNLOAD;
+        if (transfer_submit(&engine, type, argv[++i]) < 0)
+        {
+            fprintf(stderr, "Error: Cannot queue %s\n", argv[i]);
+            transfer_engine_destroy(&engine);
+            exit(EXIT_FAILURE);
+        }
+        batch_jobs++;
+    }
+
+    if (batch_jobs > 0)
+    {
+        int status = run_batch(&engine);
+        transfer_engine_destroy(&engine);
+        return status;
+    }
+
     int client_socket;
     struct sockaddr_in server_addr;
     char command[MAX_COMMAND_LENGTH];
@@ -155,7 +225,7 @@ int main(int argc, char *argv[])
 
     server_addr.sin_family = AF_INET;
     server_addr.sin_port = htons(PORT);
-    if (inet_pton(AF_INET, "127.0.0.1", &server_addr.sin_addr) <= 0)
+    if (inet_pton(AF_INET, SERVER_ADDRESS, &server_addr.sin_addr) <= 0)
     {
         perror("Invalid address");
         close(client_socket);
@@ -183,91 +253,98 @@ int main(int argc, char *argv[])
 
     printf("\nAvailable commands:\n");
     printf("LIST                  - List all files in server\n");
-    printf("UPLOAD <filename>     - Upload a file to server\n");
-    printf("DOWNLOAD <filename>   - Download a file from server\n");
+    printf("UPLOAD <filename>     - Upload a file to server (background)\n");
+    printf("DOWNLOAD <filename>   - Download a file from server (background)\n");
+    printf("JOBS                  - Show transfer progress and throughput\n");
+    printf("WAIT                  - Wait for all transfers to finish\n");
     printf("DELETE <filename>     - Delete a file (admin only)\n");
     printf("RENAME <old> <new>    - Rename a file (admin only)\n");
     printf("EXIT                  - Disconnect from server\n\n");
 
-    // Main command loop
+    engine.on_complete = on_transfer_complete;
+    engine.ctx = username;
+
+    // Main command loop - transfers keep running while we wait for input
     while (1)
     {
         printf("%s> ", username); // Changed prompt to show username
         fflush(stdout);
 
-        if (!fgets(command, sizeof(command), stdin))
+        int stdin_fd = STDIN_FILENO;
+        int status = read_command(command, sizeof(command), 0);
+        while (status == 0)
+        {
+            if (transfer_engine_step(&engine, &stdin_fd, 1, 250) & 1)
+                status = read_command(command, sizeof(command), 1);
+        }
+        if (status < 0)
         {
             break;
         }
 
-        command[strcspn(command, "\n")] = '\0';
-
         // Process user commands
         if (strcmp(command, "EXIT") == 0)
         {
-            send(client_socket, command, strlen(command), 0);
             break;
         }
         else if (strncmp(command, "LIST", 4) == 0)
         {
             // Show file listing
             send(client_socket, command, strlen(command), 0);
-            while (1)
+            if (read_reply(&engine, client_socket, 1) < 0)
             {
-                memset(buffer, 0, sizeof(buffer));
-                ssize_t bytes = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
-                if (bytes <= 0)
-                    break;
-
-                buffer[bytes] = '\0';
-                printf("%s", buffer);
-                if (strstr(buffer, "END_OF_LIST"))
-                {
-                    break;
-                }
+                printf("Server closed the connection\n");
+                break;
             }
         }
-        else if (strncmp(command, "UPLOAD", 6) == 0)
+        else if (strncmp(command, "UPLOAD", 6) == 0 ||
+                 strncmp(command, "DOWNLOAD", 8) == 0)
         {
-            // Handle file upload
-            char *filename = command + 7;
-            if (strlen(filename) == 0)
+            // Queue a background transfer on its own connection
+            int is_upload = strncmp(command, "UPLOAD", 6) == 0;
+            char *filename = command + (is_upload ? 7 : 9);
+            if (strlen(command) <= (size_t)(is_upload ? 7 : 9))
             {
                 printf("Error: Please specify a filename\n");
                 continue;
             }
-            send(client_socket, command, strlen(command), 0);
-            handle_upload(client_socket, filename);
+            int id = transfer_submit(&engine,
+                                     is_upload ? TRANSFER_UPLOAD : TRANSFER_DOWNLOAD,
+                                     filename);
+            if (id < 0)
+                printf("Error: Cannot queue transfer for %s\n", filename);
+            else
+                printf("[#%d] Queued %s of '%s'\n", id,
+                       is_upload ? "upload" : "download", filename);
         }
-        else if (strncmp(command, "DOWNLOAD", 8) == 0)
+        else if (strcmp(command, "JOBS") == 0)
         {
-            // Handle file download
-            char *filename = command + 9;
-            if (strlen(filename) == 0)
-            {
-                printf("Error: Please specify a filename\n");
-                continue;
-            }
-            send(client_socket, command, strlen(command), 0);
-            handle_download(client_socket, filename);
+            if (engine.count == 0)
+                printf("No transfers\n");
+            transfer_print_status(&engine, stdout, 0);
+        }
+        else if (strcmp(command, "WAIT") == 0)
+        {
+            // The prompt is printed again once WAIT returns
+            engine.ctx = NULL;
+            wait_for_transfers(&engine, 0);
+            engine.ctx = username;
         }
         else if (strncmp(command, "DELETE", 6) == 0 ||
                  strncmp(command, "RENAME", 6) == 0)
         {
             // Handle admin commands
             char *params = command + 7;
-            if (strlen(params) == 0)
+            if (strlen(command) <= 7 || strlen(params) == 0)
             {
                 printf("Error: Please specify old and new filenames\n");
                 continue;
             }
             send(client_socket, command, strlen(command), 0);
-            memset(buffer, 0, sizeof(buffer));
-            ssize_t recv_len = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
-            if (recv_len > 0)
+            if (read_reply(&engine, client_socket, 0) < 0)
             {
-                buffer[recv_len] = '\0';
-                printf("%s", buffer);
+                printf("Server closed the connection\n");
+                break;
             }
         }
         else
@@ -276,8 +353,18 @@ int main(int argc, char *argv[])
         }
     }
 
+    // Let background transfers finish before disconnecting
+    if (transfer_engine_pending(&engine) > 0)
+    {
+        printf("Waiting for %d transfer(s) to finish...\n", transfer_engine_pending(&engine));
+        engine.ctx = NULL;
+        wait_for_transfers(&engine, 0);
+    }
+
     // Cleanup and exit
+    send(client_socket, "EXIT", 4, MSG_NOSIGNAL);
     close(client_socket);
+    transfer_engine_destroy(&engine);
     printf("Disconnected from server.\n");
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,419 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "io_policy.h"
+
+#define CACHED_BUFFER_SIZE 1024
+
+static IoRule rules[IO_MAX_RULES] = {{"", IO_MODE_STREAM, IO_DEFAULT_THRESHOLD}};
+static int rule_count = 1;
+static IoStats *stats = NULL;
+
+const char *io_mode_name(IoMode mode)
+{
+    switch (mode)
+    {
+    case IO_MODE_CACHED:
+        return "cached";
+    case IO_MODE_STREAM:
+        return "stream";
+    case IO_MODE_DIRECT:
+        return "direct";
+    }
+    return "unknown";
+}
+
+static int parse_mode(const char *text, IoMode *mode)
+{
+    for (int m = IO_MODE_CACHED; m <= IO_MODE_DIRECT; m++)
+    {
+        if (strcmp(text, io_mode_name(m)) == 0)
+        {
+            *mode = m;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Accepts plain bytes or a K/M/G suffix
+int io_parse_size(const char *text, size_t *size)
+{
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (errno != 0 || end == text)
+        return -1;
+
+    switch (*end)
+    {
+    case 'G':
+    case 'g':
+        value *= 1024;
+        // fall through
+    case 'M':
+    case 'm':
+        value *= 1024;
+        // fall through
+    case 'K':
+    case 'k':
+        value *= 1024;
+        end++;
+        break;
+    default:
+        break;
+    }
+    if (*end != '\0')
+        return -1;
+
+    *size = value;
+    return 0;
+}
+
+int io_policy_init(void)
+{
+    stats = mmap(NULL, sizeof(IoStats), PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED)
+    {
+        stats = NULL;
+        return -1;
+    }
+    memset(stats, 0, sizeof(*stats));
+    return 0;
+}
+
+void io_policy_set_threshold(size_t threshold)
+{
+    rules[0].threshold = threshold;
+}
+
+int io_policy_add_rule(const char *spec)
+{
+    char copy[512];
+    strncpy(copy, spec, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = '\0';
+
+    char *prefix = "";
+    char *mode_text = copy;
+    char *equals = strchr(copy, '=');
+    if (equals)
+    {
+        *equals = '\0';
+        prefix = copy;
+        mode_text = equals + 1;
+    }
+
+    IoRule rule;
+    memset(&rule, 0, sizeof(rule));
+    strncpy(rule.prefix, prefix, sizeof(rule.prefix) - 1);
+
+    char *colon = strchr(mode_text, ':');
+    if (colon)
+    {
+        *colon = '\0';
+        if (io_parse_size(colon + 1, &rule.threshold) < 0)
+            return -1;
+    }
+    if (parse_mode(mode_text, &rule.mode) < 0)
+        return -1;
+
+    // A bare mode changes the default rule but keeps its threshold
+    if (rule.prefix[0] == '\0' && rule.threshold == 0)
+        rule.threshold = rules[0].threshold;
+
+    // Replace an existing rule for the same prefix
+    for (int i = 0; i < rule_count; i++)
+    {
+        if (strcmp(rules[i].prefix, rule.prefix) == 0)
+        {
+            rules[i] = rule;
+            return 0;
+        }
+    }
+    if (rule_count >= IO_MAX_RULES)
+        return -1;
+    rules[rule_count++] = rule;
+    return 0;
+}
+
+void io_policy_print(void)
+{
+    for (int i = 0; i < rule_count; i++)
+    {
+        printf("[INFO] I/O policy: %-20s %s at >= %zu bytes\n",
+               rules[i].prefix[0] ? rules[i].prefix : "(default)",
+               io_mode_name(rules[i].mode),
+               rules[i].threshold ? rules[i].threshold : rules[0].threshold);
+    }
+}
+
+const IoStats *io_policy_stats(void)
+{
+    return stats;
+}
+
+static const IoRule *match_rule(const char *filename)
+{
+    const IoRule *best = &rules[0];
+    for (int i = 1; i < rule_count; i++)
+    {
+        size_t len = strlen(rules[i].prefix);
+        if (strncmp(filename, rules[i].prefix, len) == 0 && len > strlen(best->prefix))
+            best = &rules[i];
+    }
+    return best;
+}
+
+// Count pages of [offset, offset + length) currently in the page cache
+static unsigned long resident_pages(int fd, off_t offset, size_t length)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t pages = (length + page_size - 1) / page_size;
+    unsigned long resident = 0;
+
+    void *map = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, offset);
+    if (map == MAP_FAILED)
+        return 0;
+
+    unsigned char *vec = malloc(pages);
+    if (vec && mincore(map, length, vec) == 0)
+    {
+        for (size_t i = 0; i < pages; i++)
+            resident += vec[i] & 1;
+    }
+    free(vec);
+    munmap(map, length);
+    return resident;
+}
+
+// Release the pages behind the stream up to offset, recording how many were cached
+static void drop_behind(IoStream *stream, off_t upto)
+{
+    if (upto <= stream->dropped_upto)
+        return;
+
+    off_t start = stream->dropped_upto;
+    size_t length = upto - start;
+
+    // Dirty pages cannot be dropped until they have been written back. For
+    // uploads io_stream_write() already started writeback on this range, so
+    // this normally only waits on I/O that has had a window's time to finish.
+    if (stream->writing)
+    {
+        sync_file_range(stream->fd, start, length,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                            SYNC_FILE_RANGE_WAIT_AFTER);
+    }
+
+    unsigned long before = resident_pages(stream->fd, start, length);
+    posix_fadvise(stream->fd, start, length, POSIX_FADV_DONTNEED);
+    unsigned long after = resident_pages(stream->fd, start, length);
+
+    stream->pages_evicted += before > after ? before - after : 0;
+    stream->bytes_dropped += length;
+    stream->dropped_upto = upto;
+}
+
+// Allocate the transfer buffer, aligned so O_DIRECT can use it
+static int setup_buffer(IoStream *stream, int large)
+{
+    free(stream->buffer);
+    stream->buffer = NULL;
+    stream->buffer_size = large ? IO_LARGE_BUFFER_SIZE : CACHED_BUFFER_SIZE;
+    if (posix_memalign((void **)&stream->buffer, IO_DIRECT_ALIGNMENT, stream->buffer_size) != 0)
+    {
+        stream->buffer = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static void init_stream(IoStream *stream, const char *filename, int writing)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->fd = -1;
+    stream->writing = writing;
+    strncpy(stream->filename, filename, sizeof(stream->filename) - 1);
+
+    const IoRule *rule = match_rule(filename);
+    stream->mode = rule->mode;
+    stream->threshold = rule->threshold ? rule->threshold : rules[0].threshold;
+}
+
+int io_stream_open_read(IoStream *stream, const char *filepath, const char *filename)
+{
+    struct stat file_stat;
+    init_stream(stream, filename, 0);
+
+    if (stat(filepath, &file_stat) < 0)
+        return -1;
+    stream->large = stream->mode != IO_MODE_CACHED &&
+                    (size_t)file_stat.st_size >= stream->threshold;
+
+    if (stream->large && stream->mode == IO_MODE_DIRECT)
+    {
+        stream->fd = open(filepath, O_RDONLY | O_DIRECT);
+        // Not every filesystem supports O_DIRECT, fall back to streaming
+        if (stream->fd < 0 && errno == EINVAL)
+            stream->mode = IO_MODE_STREAM;
+    }
+    if (stream->fd < 0)
+        stream->fd = open(filepath, O_RDONLY);
+    if (stream->fd < 0)
+        return -1;
+
+    if (stream->large && stream->mode == IO_MODE_STREAM)
+    {
+        posix_fadvise(stream->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(stream->fd, 0, IO_WINDOW_SIZE, POSIX_FADV_WILLNEED);
+        stream->readahead_upto = IO_WINDOW_SIZE;
+    }
+
+    if (setup_buffer(stream, stream->large) < 0)
+    {
+        close(stream->fd);
+        stream->fd = -1;
+        return -1;
+    }
+    return stream->fd;
+}
+
+int io_stream_open_write(IoStream *stream, const char *filepath, const char *filename)
+{
+    init_stream(stream, filename, 1);
+
+    // Uploads have no size up front and end on arbitrary boundaries, which
+    // O_DIRECT cannot handle, so direct rules use write-behind instead
+    if (stream->mode == IO_MODE_DIRECT)
+        stream->mode = IO_MODE_STREAM;
+
+    // Read access is needed to measure residency before dropping pages
+    stream->fd = open(filepath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (stream->fd < 0)
+        return -1;
+
+    // The size is only known once the threshold is crossed, so any upload
+    // that may become large receives into the large buffer from the start
+    if (setup_buffer(stream, stream->mode != IO_MODE_CACHED) < 0)
+    {
+        close(stream->fd);
+        stream->fd = -1;
+        return -1;
+    }
+    return stream->fd;
+}
+
+// Fill stream->buffer with the next chunk of the file
+ssize_t io_stream_read(IoStream *stream)
+{
+    ssize_t bytes_read = read(stream->fd, stream->buffer, stream->buffer_size);
+    if (bytes_read < 0 && errno == EINVAL && stream->mode == IO_MODE_DIRECT)
+    {
+        // O_DIRECT was accepted at open but rejected on read
+        fcntl(stream->fd, F_SETFL, fcntl(stream->fd, F_GETFL) & ~O_DIRECT);
+        stream->mode = IO_MODE_STREAM;
+        bytes_read = read(stream->fd, stream->buffer, stream->buffer_size);
+    }
+    if (bytes_read <= 0)
+        return bytes_read;
+
+    stream->offset += bytes_read;
+
+    if (stream->large && stream->mode == IO_MODE_STREAM)
+    {
+        // Keep one window of readahead in flight and drop what we have sent
+        if (stream->offset + (off_t)IO_WINDOW_SIZE > stream->readahead_upto)
+        {
+            posix_fadvise(stream->fd, stream->readahead_upto, IO_WINDOW_SIZE,
+                          POSIX_FADV_WILLNEED);
+            stream->readahead_upto += IO_WINDOW_SIZE;
+        }
+        if (stream->offset - stream->dropped_upto >= (off_t)IO_WINDOW_SIZE)
+            drop_behind(stream, stream->offset);
+    }
+    return bytes_read;
+}
+
+// Write data, switching to write-behind once the file crosses the threshold.
+// Each filled window gets asynchronous writeback, and the window before it is
+// waited on and dropped, so the upload never stalls on the window it just wrote.
+ssize_t io_stream_write(IoStream *stream, const void *data, size_t length)
+{
+    ssize_t written = write(stream->fd, data, length);
+    if (written <= 0)
+        return written;
+
+    stream->offset += written;
+    if (!stream->large && stream->mode != IO_MODE_CACHED &&
+        (size_t)stream->offset >= stream->threshold)
+    {
+        stream->large = 1;
+    }
+
+    // Stay window-aligned so sync_file_range never splits a page
+    off_t filled = stream->offset - stream->offset % IO_WINDOW_SIZE;
+    if (stream->large && filled > stream->writeback_upto)
+    {
+        sync_file_range(stream->fd, stream->writeback_upto, filled - stream->writeback_upto,
+                        SYNC_FILE_RANGE_WRITE);
+        drop_behind(stream, stream->writeback_upto);
+        stream->writeback_upto = filled;
+    }
+    return written;
+}
+
+// Drop any remaining pages of a large stream, update shared stats and log
+void io_stream_close(IoStream *stream)
+{
+    if (stream->fd < 0)
+        return;
+
+    if (stream->large && stream->mode != IO_MODE_DIRECT)
+        drop_behind(stream, stream->offset);
+    close(stream->fd);
+    stream->fd = -1;
+    free(stream->buffer);
+    stream->buffer = NULL;
+
+    if (stats)
+    {
+        if (stream->large)
+        {
+            __atomic_add_fetch(&stats->large_transfers, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&stats->bytes_large, stream->offset, __ATOMIC_RELAXED);
+            if (stream->mode == IO_MODE_DIRECT)
+                __atomic_add_fetch(&stats->direct_transfers, 1, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            __atomic_add_fetch(&stats->small_transfers, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&stats->bytes_cached, stream->offset, __ATOMIC_RELAXED);
+        }
+        __atomic_add_fetch(&stats->bytes_dropped, stream->bytes_dropped, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stats->pages_evicted, stream->pages_evicted, __ATOMIC_RELAXED);
+    }
+
+    if (stream->large)
+    {
+        printf("[IO] %s %s: %s, %lld bytes, dropped %llu bytes (%llu cached pages evicted)\n",
+               stream->writing ? "Upload" : "Download", stream->filename,
+               io_mode_name(stream->mode), (long long)stream->offset,
+               stream->bytes_dropped, stream->pages_evicted);
+        if (stats)
+        {
+            printf("[IO] Totals: %lu small (%llu bytes), %lu large (%llu bytes, %lu direct), "
+                   "%llu bytes dropped, %llu pages evicted\n",
+                   stats->small_transfers, stats->bytes_cached, stats->large_transfers,
+                   stats->bytes_large, stats->direct_transfers, stats->bytes_dropped,
+                   stats->pages_evicted);
+        }
+    }
+}
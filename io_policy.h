@@ -0,0 +1,80 @@
+#ifndef IO_POLICY_H
+#define IO_POLICY_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define IO_DEFAULT_THRESHOLD (16UL * 1024 * 1024)
+#define IO_WINDOW_SIZE (8UL * 1024 * 1024)
+#define IO_LARGE_BUFFER_SIZE (256UL * 1024)
+#define IO_DIRECT_ALIGNMENT 4096
+#define IO_MAX_RULES 16
+
+// How a file at or above its rule's threshold is read or written.
+// Files below the threshold always use IO_MODE_CACHED.
+typedef enum
+{
+    IO_MODE_CACHED, // Plain buffered I/O
+    IO_MODE_STREAM, // Sequential readahead, drop pages behind the stream
+    IO_MODE_DIRECT  // O_DIRECT with aligned buffers, bypassing the page cache
+} IoMode;
+
+// Policy for files whose name starts with prefix (longest prefix wins).
+// A threshold of 0 inherits the default rule's threshold.
+typedef struct
+{
+    char prefix[256];
+    IoMode mode;
+    size_t threshold;
+} IoRule;
+
+// Counters shared by all client processes
+typedef struct
+{
+    unsigned long small_transfers;
+    unsigned long large_transfers;
+    unsigned long direct_transfers;
+    unsigned long long bytes_cached;
+    unsigned long long bytes_large;
+    unsigned long long bytes_dropped;
+    unsigned long long pages_evicted;
+} IoStats;
+
+// Per-transfer state for one open file
+typedef struct
+{
+    int fd;
+    IoMode mode;  // Mode from the matching rule
+    int large;    // Set once the file is past the rule's threshold
+    int writing;
+    size_t threshold;
+    off_t offset;
+    off_t dropped_upto;
+    off_t writeback_upto; // Uploads: async writeback started up to here
+    off_t readahead_upto;
+    unsigned long long bytes_dropped;
+    unsigned long long pages_evicted;
+    char *buffer;
+    size_t buffer_size;
+    char filename[256];
+} IoStream;
+
+// Must run before fork() so the stats are shared between processes
+int io_policy_init(void);
+
+// Parse "<prefix>=<cached|stream|direct>[:<size>]", or a bare mode for the default rule
+int io_policy_add_rule(const char *spec);
+void io_policy_set_threshold(size_t threshold);
+int io_parse_size(const char *text, size_t *size);
+const char *io_mode_name(IoMode mode);
+void io_policy_print(void);
+
+int io_stream_open_read(IoStream *stream, const char *filepath, const char *filename);
+int io_stream_open_write(IoStream *stream, const char *filepath, const char *filename);
+ssize_t io_stream_read(IoStream *stream);
+ssize_t io_stream_write(IoStream *stream, const void *data, size_t length);
+void io_stream_close(IoStream *stream);
+
+const IoStats *io_policy_stats(void);
+
+#endif
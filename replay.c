@@ -0,0 +1,970 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+
+#include "trace.h"
+
+#define PORT 8080
+#define SERVER_ADDRESS "127.0.0.1"
+#define BUFFER_SIZE 8192
+#define CONNECT_ATTEMPTS 20
+#define CONNECT_RETRY_US 50000
+
+// Per-command results, one slot per trace record
+typedef struct
+{
+    uint64_t latency_us;
+    uint64_t bytes;
+    int status;
+    int skipped;  // Could not be replayed faithfully, left out of the stats
+    int rejected; // Session could not connect, so the record never ran
+    int done;
+    size_t after[2]; // Earlier records on the same files, as index + 1
+    size_t prev_open;   // First record of the previous session, as index + 1
+    size_t live_before; // Sessions open in the trace when this one opened
+} ReplayResult;
+
+// One replayed client connection
+typedef struct
+{
+    uint32_t session;
+    size_t *events; // Indexes into the trace, in order
+    size_t count;
+    size_t capacity;
+    int sock;
+    int is_admin;
+    int live; // Counted in live_sessions
+} Session;
+
+// Open-addressing map from a 32-bit id to a caller-defined value
+typedef struct
+{
+    uint32_t *keys;
+    size_t *values; // 0 marks an empty bucket, so callers store index + 1
+    size_t mask;
+} IdTable;
+
+// Latency and throughput summary for one command type
+typedef struct
+{
+    unsigned long count;
+    unsigned long errors;
+    double mean_us;
+    double p50_us;
+    double p95_us;
+    double p99_us;
+    unsigned long long bytes;
+    double busy_us;
+} CommandSummary;
+
+static TraceRecord *records = NULL;
+static size_t record_count = 0;
+static ReplayResult *results = NULL;
+static double speed = 1.0;
+static uint64_t replay_start_us = 0;
+static char payload[BUFFER_SIZE];
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static size_t live_sessions = 0; // Guarded by done_lock
+
+static uint64_t now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void replay_name(uint32_t file_id, char *out, size_t size)
+{
+    snprintf(out, size, "replay_%08x", file_id);
+}
+
+static int id_table_init(IdTable *table, size_t expected)
+{
+    size_t capacity = 16;
+    while (capacity < expected * 2)
+        capacity *= 2;
+
+    table->keys = calloc(capacity, sizeof(uint32_t));
+    table->values = calloc(capacity, sizeof(size_t));
+    table->mask = capacity - 1;
+    if (!table->keys || !table->values)
+    {
+        free(table->keys);
+        free(table->values);
+        return -1;
+    }
+    return 0;
+}
+
+static void id_table_free(IdTable *table)
+{
+    free(table->keys);
+    free(table->values);
+}
+
+// Returns the value slot for key, adding an empty one if it is missing
+static size_t *id_table_slot(IdTable *table, uint32_t key)
+{
+    size_t bucket = (key * 2654435761u) & table->mask;
+    while (table->values[bucket] != 0 && table->keys[bucket] != key)
+        bucket = (bucket + 1) & table->mask;
+    table->keys[bucket] = key;
+    return &table->values[bucket];
+}
+
+static int compare_timestamp(const void *a, const void *b)
+{
+    uint64_t x = ((const TraceRecord *)a)->timestamp_us;
+    uint64_t y = ((const TraceRecord *)b)->timestamp_us;
+    return x < y ? -1 : x > y;
+}
+
+static int load_trace(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        perror("Cannot open trace");
+        return -1;
+    }
+
+    TraceHeader header;
+    if (trace_read_header(file, &header) < 0)
+    {
+        fprintf(stderr, "Error: %s is not a version %d trace\n", path, TRACE_VERSION);
+        fclose(file);
+        return -1;
+    }
+
+    size_t capacity = 1024;
+    records = malloc(capacity * sizeof(TraceRecord));
+    while (records && fread(&records[record_count], sizeof(TraceRecord), 1, file) == 1)
+    {
+        if (++record_count == capacity)
+        {
+            capacity *= 2;
+            TraceRecord *grown = realloc(records, capacity * sizeof(TraceRecord));
+            if (!grown)
+            {
+                free(records);
+                records = NULL;
+                break;
+            }
+            records = grown;
+        }
+    }
+    fclose(file);
+
+    if (!records)
+    {
+        fprintf(stderr, "Error: Out of memory loading trace\n");
+        return -1;
+    }
+
+    // Records are appended as commands finish, put them back in start order
+    qsort(records, record_count, sizeof(TraceRecord), compare_timestamp);
+    return 0;
+}
+
+static int send_all(int sock, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t sent = send(sock, data, length, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return -1;
+        data += sent;
+        length -= sent;
+    }
+    return 0;
+}
+
+// Read a single reply, returns 0 unless it is an ERROR or the server went away
+static int read_reply(int sock, char *buffer, size_t size)
+{
+    ssize_t received = recv(sock, buffer, size - 1, 0);
+    if (received <= 0)
+        return -1;
+    buffer[received] = '\0';
+    return strncmp(buffer, "ERROR", 5) == 0 ? -1 : 0;
+}
+
+// Returns 0 once welcomed, -2 if the server turned the connection away
+// and -1 on any other failure
+static int session_connect(Session *session)
+{
+    struct sockaddr_in server_addr;
+    char buffer[BUFFER_SIZE];
+
+    session->sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (session->sock < 0)
+        return -1;
+
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(PORT);
+    inet_pton(AF_INET, SERVER_ADDRESS, &server_addr.sin_addr);
+    if (connect(session->sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+    {
+        close(session->sock);
+        session->sock = -1;
+        return -1;
+    }
+
+    snprintf(buffer, sizeof(buffer), "USERNAME replay%u", session->session);
+    if (send_all(session->sock, buffer, strlen(buffer)) < 0 ||
+        read_reply(session->sock, buffer, sizeof(buffer)) < 0 ||
+        strncmp(buffer, "Welcome", 7) != 0)
+    {
+        int full = strncmp(buffer, "Server is full", 14) == 0;
+        close(session->sock);
+        session->sock = -1;
+        return full ? -2 : -1;
+    }
+    session->is_admin = strstr(buffer, "You are the admin") != NULL;
+    return 0;
+}
+
+// Close and wait for the server to drop the connection, so its slot (and any
+// admin rights) are released before the next session connects
+static void session_close_wait(Session *session)
+{
+    char buffer[BUFFER_SIZE];
+    if (session->sock < 0)
+        return;
+    send(session->sock, "EXIT", 4, MSG_NOSIGNAL);
+    shutdown(session->sock, SHUT_WR);
+    while (recv(session->sock, buffer, sizeof(buffer), 0) > 0)
+        ;
+    close(session->sock);
+    session->sock = -1;
+}
+
+// Close a replayed session and give its slot to sessions waiting to connect
+static void session_end(Session *session)
+{
+    session_close_wait(session);
+    if (!session->live)
+        return;
+
+    pthread_mutex_lock(&done_lock);
+    live_sessions--;
+    session->live = 0;
+    pthread_cond_broadcast(&done_cond);
+    pthread_mutex_unlock(&done_lock);
+}
+
+static int replay_list(int sock)
+{
+    char buffer[BUFFER_SIZE];
+    if (send_all(sock, "LIST", 4) < 0)
+        return -1;
+    while (1)
+    {
+        ssize_t received = recv(sock, buffer, sizeof(buffer) - 1, 0);
+        if (received <= 0)
+            return -1;
+        buffer[received] = '\0';
+        if (strstr(buffer, "END_OF_LIST"))
+            return 0;
+    }
+}
+
+// Upload size bytes of synthetic payload
+static int replay_upload(int sock, const char *name, uint64_t size)
+{
+    char buffer[BUFFER_SIZE];
+    snprintf(buffer, sizeof(buffer), "UPLOAD %s", name);
+    if (send_all(sock, buffer, strlen(buffer)) < 0)
+        return -1;
+    if (read_reply(sock, buffer, sizeof(buffer)) < 0 || !strstr(buffer, "READY_FOR_UPLOAD"))
+        return -1;
+
+    while (size > 0)
+    {
+        size_t chunk = size < sizeof(payload) ? size : sizeof(payload);
+        if (send_all(sock, payload, chunk) < 0)
+            return -1;
+        size -= chunk;
+    }
+    if (send_all(sock, "END_OF_UPLOAD", 13) < 0)
+        return -1;
+    return read_reply(sock, buffer, sizeof(buffer));
+}
+
+// Download and discard a file, returns bytes received or -1
+static long long replay_download(int sock, const char *name)
+{
+    const size_t marker_len = strlen("END_OF_FILE");
+    char buffer[BUFFER_SIZE];
+    size_t pending = 0;
+    long long total = 0;
+
+    snprintf(buffer, sizeof(buffer), "DOWNLOAD %s", name);
+    if (send_all(sock, buffer, strlen(buffer)) < 0)
+        return -1;
+
+    while (1)
+    {
+        ssize_t received = recv(sock, buffer + pending, sizeof(buffer) - pending, 0);
+        if (received <= 0)
+            return -1;
+        pending += received;
+
+        if (total == 0 && pending >= 6 && strncmp(buffer, "ERROR:", 6) == 0)
+            return -1;
+
+        char *end_marker = memmem(buffer, pending, "END_OF_FILE", marker_len);
+        if (end_marker)
+            return total + (end_marker - buffer);
+
+        size_t consumed = pending > marker_len - 1 ? pending - (marker_len - 1) : 0;
+        total += consumed;
+        memmove(buffer, buffer + consumed, pending - consumed);
+        pending -= consumed;
+    }
+}
+
+static int replay_simple(int sock, const char *request)
+{
+    char buffer[BUFFER_SIZE];
+    if (send_all(sock, request, strlen(request)) < 0)
+        return -1;
+    return read_reply(sock, buffer, sizeof(buffer));
+}
+
+// Hold a session back until no more sessions are open than the trace had
+// when it connected. Earlier sessions only hold a slot until their DISCONNECT
+// is replayed, and those records never wait on later ones.
+static void wait_for_slot(Session *session, size_t live_before)
+{
+    pthread_mutex_lock(&done_lock);
+    while (live_sessions > live_before)
+        pthread_cond_wait(&done_cond, &done_lock);
+    live_sessions++;
+    session->live = 1;
+    pthread_mutex_unlock(&done_lock);
+}
+
+// Sessions that were admin in the trace had the server to themselves, so
+// they retry until it has reaped the sessions closed before them. Retries
+// also cover a "Server is full" from connections not reaped yet.
+static int session_open(Session *session, const TraceRecord *record)
+{
+    int want_admin = record->command == TRACE_CONNECT && (record->flags & TRACE_FLAG_ADMIN);
+
+    int status = -1;
+    for (int attempt = 0; attempt < CONNECT_ATTEMPTS; attempt++)
+    {
+        status = session_connect(session);
+        if (status == 0 && (session->is_admin || !want_admin))
+            return 0;
+        if (status == -1 || attempt == CONNECT_ATTEMPTS - 1)
+            break;
+        session_close_wait(session);
+        usleep(CONNECT_RETRY_US);
+    }
+
+    // An admin session that never got its rights still replays, its admin
+    // commands are reported as unreplayable
+    if (status == 0)
+    {
+        printf("Session %u could not get admin rights\n", session->session);
+        return 0;
+    }
+    session_end(session);
+    return -1;
+}
+
+// Issue one traced command on the session's connection. Returns 0 on success,
+// -1 on error and 1 if the record cannot be replayed faithfully.
+static int replay_record(Session *session, const TraceRecord *record, uint64_t *bytes)
+{
+    char name[32], target[32], request[96];
+    replay_name(record->file_id, name, sizeof(name));
+    replay_name(record->aux_id, target, sizeof(target));
+    *bytes = 0;
+
+    if (record->command == TRACE_CONNECT)
+        return 0;
+    if (record->command == TRACE_DISCONNECT)
+    {
+        session_end(session);
+        return 0;
+    }
+    if (session->sock < 0)
+        return -1;
+
+    // The server grants admin rights by connection order, which a replay
+    // cannot reproduce. Admin commands only say something if it matches.
+    if ((record->command == TRACE_DELETE || record->command == TRACE_RENAME) &&
+        session->is_admin != ((record->flags & TRACE_FLAG_ADMIN) != 0))
+        return 1;
+
+    switch (record->command)
+    {
+    case TRACE_LIST:
+        return replay_list(session->sock);
+    case TRACE_UPLOAD:
+        *bytes = record->bytes;
+        return replay_upload(session->sock, name, record->bytes);
+    case TRACE_DOWNLOAD:
+    {
+        long long received = replay_download(session->sock, name);
+        if (received < 0)
+            return -1;
+        *bytes = received;
+        return 0;
+    }
+    case TRACE_DELETE:
+        snprintf(request, sizeof(request), "DELETE %s", name);
+        return replay_simple(session->sock, request);
+    case TRACE_RENAME:
+        snprintf(request, sizeof(request), "RENAME %s %s", name, target);
+        return replay_simple(session->sock, request);
+    default:
+        return replay_simple(session->sock, "NOOP");
+    }
+}
+
+static void wait_for_record(size_t after)
+{
+    if (after == 0)
+        return;
+    pthread_mutex_lock(&done_lock);
+    while (!results[after - 1].done)
+        pthread_cond_wait(&done_cond, &done_lock);
+    pthread_mutex_unlock(&done_lock);
+}
+
+// Mark the records from first on as not replayed, so other sessions stop
+// waiting on them
+static void reject_session(Session *session, size_t first)
+{
+    pthread_mutex_lock(&done_lock);
+    for (size_t i = first; i < session->count; i++)
+    {
+        results[session->events[i]].rejected = 1;
+        results[session->events[i]].done = 1;
+    }
+    pthread_cond_broadcast(&done_cond);
+    pthread_mutex_unlock(&done_lock);
+}
+
+// Replays one session, keeping each command at its traced offset scaled by
+// speed. Commands on a file also wait for earlier commands on that file in
+// other sessions, and sessions connect in traced order, so accelerated
+// replays keep the traced order and concurrency.
+static void *session_thread(void *arg)
+{
+    Session *session = arg;
+
+    for (size_t i = 0; i < session->count; i++)
+    {
+        size_t index = session->events[i];
+        const TraceRecord *record = &records[index];
+
+        if (speed > 0)
+        {
+            uint64_t due = replay_start_us + (uint64_t)(record->timestamp_us / speed);
+            uint64_t now = now_us();
+            if (due > now)
+                usleep(due - now);
+        }
+
+        wait_for_record(results[index].after[0]);
+        wait_for_record(results[index].after[1]);
+
+        if (i == 0)
+        {
+            wait_for_record(results[index].prev_open);
+            wait_for_slot(session, results[index].live_before);
+        }
+
+        uint64_t started = now_us();
+        if (i == 0 && session_open(session, record) < 0)
+        {
+            reject_session(session, 0);
+            return NULL;
+        }
+
+        uint64_t bytes;
+        int status = replay_record(session, record, &bytes);
+
+        pthread_mutex_lock(&done_lock);
+        results[index].latency_us = now_us() - started;
+        results[index].bytes = bytes;
+        results[index].status = status < 0 ? 1 : 0;
+        results[index].skipped = status > 0;
+        results[index].done = 1;
+        pthread_cond_broadcast(&done_cond);
+        pthread_mutex_unlock(&done_lock);
+    }
+
+    session_end(session);
+    return NULL;
+}
+
+static int touches_files(const TraceRecord *record)
+{
+    return record->command == TRACE_UPLOAD || record->command == TRACE_DOWNLOAD ||
+           record->command == TRACE_DELETE || record->command == TRACE_RENAME;
+}
+
+// Link each file command to the previous command on each of its files.
+// Waiting on that one is enough, since it waited on its own predecessor.
+// Also chains the first record of each session to that of the previous
+// session and notes how many sessions the trace had open at that point.
+static int link_dependencies(void)
+{
+    IdTable last, open;
+    if (id_table_init(&last, record_count * 2) < 0)
+        return -1;
+    if (id_table_init(&open, record_count) < 0)
+    {
+        id_table_free(&last);
+        return -1;
+    }
+
+    size_t live = 0, last_open = 0;
+    for (size_t i = 0; i < record_count; i++)
+    {
+        const TraceRecord *record = &records[i];
+
+        // 1 while the session is open, 2 once it has disconnected
+        size_t *state = id_table_slot(&open, record->session);
+        if (*state == 0)
+        {
+            results[i].prev_open = last_open;
+            results[i].live_before = live;
+            last_open = i + 1;
+            live++;
+            *state = 1;
+        }
+        if (record->command == TRACE_DISCONNECT && *state == 1)
+        {
+            live--;
+            *state = 2;
+        }
+
+        if (!touches_files(record))
+            continue;
+
+        uint32_t ids[2] = {record->file_id, record->aux_id};
+        int id_count = record->command == TRACE_RENAME ? 2 : 1;
+        for (int k = 0; k < id_count; k++)
+        {
+            if (ids[k] == 0)
+                continue;
+            size_t *slot = id_table_slot(&last, ids[k]);
+            results[i].after[k] = *slot;
+            *slot = i + 1;
+        }
+    }
+
+    id_table_free(&last);
+    id_table_free(&open);
+    return 0;
+}
+
+// Create every file the trace successfully reads, sized from the largest
+// traced download. Doing this up front keeps accelerated replays from racing
+// the uploads of other sessions.
+static int prepare_files(void)
+{
+    Session setup = {.session = 0, .sock = -1};
+    IdTable table;
+    char name[32];
+    int created = 0;
+
+    uint32_t *ids = malloc((record_count ? record_count : 1) * sizeof(uint32_t));
+    uint64_t *sizes = malloc((record_count ? record_count : 1) * sizeof(uint64_t));
+    if (!ids || !sizes || id_table_init(&table, record_count) < 0)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        free(ids);
+        free(sizes);
+        return -1;
+    }
+
+    // One pass to collect each file id and its largest download
+    size_t file_count = 0;
+    for (size_t i = 0; i < record_count; i++)
+    {
+        const TraceRecord *record = &records[i];
+        if (record->status != 0 || (record->command != TRACE_DOWNLOAD &&
+                                    record->command != TRACE_DELETE &&
+                                    record->command != TRACE_RENAME))
+            continue;
+
+        size_t *slot = id_table_slot(&table, record->file_id);
+        if (*slot == 0)
+        {
+            ids[file_count] = record->file_id;
+            sizes[file_count] = 0;
+            *slot = ++file_count;
+        }
+        if (record->command == TRACE_DOWNLOAD && record->bytes > sizes[*slot - 1])
+            sizes[*slot - 1] = record->bytes;
+    }
+
+    int status = 0;
+    for (size_t f = 0; f < file_count; f++)
+    {
+        if (setup.sock < 0 && session_connect(&setup) < 0)
+        {
+            fprintf(stderr, "Error: Cannot connect to server for setup\n");
+            status = -1;
+            break;
+        }
+        replay_name(ids[f], name, sizeof(name));
+        if (replay_upload(setup.sock, name, sizes[f]) < 0)
+        {
+            fprintf(stderr, "Error: Cannot create %s on server\n", name);
+            status = -1;
+            break;
+        }
+        created++;
+    }
+
+    session_close_wait(&setup);
+    id_table_free(&table);
+    free(ids);
+    free(sizes);
+    if (status == 0)
+        printf("Prepared %d synthetic file(s)\n", created);
+    return status;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void summarize(CommandSummary summary[TRACE_COMMAND_COUNT])
+{
+    uint64_t *latencies = malloc(record_count * sizeof(uint64_t));
+    memset(summary, 0, TRACE_COMMAND_COUNT * sizeof(CommandSummary));
+    if (!latencies)
+        return;
+
+    for (int command = TRACE_CONNECT; command < TRACE_COMMAND_COUNT; command++)
+    {
+        CommandSummary *s = &summary[command];
+        size_t n = 0;
+        for (size_t i = 0; i < record_count; i++)
+        {
+            if (records[i].command != command || !results[i].done || results[i].skipped ||
+                results[i].rejected)
+                continue;
+            latencies[n++] = results[i].latency_us;
+            s->errors += results[i].status;
+            s->bytes += results[i].bytes;
+            s->busy_us += results[i].latency_us;
+        }
+        if (n == 0)
+            continue;
+
+        qsort(latencies, n, sizeof(uint64_t), compare_u64);
+        s->count = n;
+        s->mean_us = s->busy_us / n;
+        s->p50_us = latencies[n * 50 / 100];
+        s->p95_us = latencies[n * 95 / 100];
+        s->p99_us = latencies[n * 99 / 100];
+    }
+    free(latencies);
+}
+
+static double throughput_mib(const CommandSummary *s)
+{
+    return s->busy_us > 0 ? s->bytes / (1024.0 * 1024.0) / (s->busy_us / 1e6) : 0;
+}
+
+static void print_summary(const CommandSummary summary[TRACE_COMMAND_COUNT])
+{
+    printf("\n%-10s %7s %6s %10s %10s %10s %10s %10s\n", "COMMAND", "COUNT", "ERRORS",
+           "MEAN ms", "P50 ms", "P95 ms", "P99 ms", "MiB/s");
+    for (int command = TRACE_CONNECT; command < TRACE_COMMAND_COUNT; command++)
+    {
+        const CommandSummary *s = &summary[command];
+        if (s->count == 0)
+            continue;
+        printf("%-10s %7lu %6lu %10.3f %10.3f %10.3f %10.3f %10.2f\n",
+               trace_command_name(command), s->count, s->errors, s->mean_us / 1000,
+               s->p50_us / 1000, s->p95_us / 1000, s->p99_us / 1000, throughput_mib(s));
+    }
+}
+
+static int save_summary(const char *path, const CommandSummary summary[TRACE_COMMAND_COUNT])
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+    {
+        perror("Cannot write summary");
+        return -1;
+    }
+    for (int command = TRACE_CONNECT; command < TRACE_COMMAND_COUNT; command++)
+    {
+        const CommandSummary *s = &summary[command];
+        fprintf(file, "%s %lu %lu %.1f %.1f %.1f %.1f %llu %.1f\n", trace_command_name(command),
+                s->count, s->errors, s->mean_us, s->p50_us, s->p95_us, s->p99_us, s->bytes,
+                s->busy_us);
+    }
+    fclose(file);
+    return 0;
+}
+
+static int load_summary(const char *path, CommandSummary summary[TRACE_COMMAND_COUNT])
+{
+    FILE *file = fopen(path, "r");
+    char name[32];
+    CommandSummary s;
+
+    if (!file)
+    {
+        perror("Cannot read baseline");
+        return -1;
+    }
+    memset(summary, 0, TRACE_COMMAND_COUNT * sizeof(CommandSummary));
+    while (fscanf(file, "%31s %lu %lu %lf %lf %lf %lf %llu %lf", name, &s.count, &s.errors,
+                  &s.mean_us, &s.p50_us, &s.p95_us, &s.p99_us, &s.bytes, &s.busy_us) == 9)
+    {
+        for (int command = TRACE_CONNECT; command < TRACE_COMMAND_COUNT; command++)
+        {
+            if (strcmp(name, trace_command_name(command)) == 0)
+                summary[command] = s;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static double percent_change(double before, double after)
+{
+    return before > 0 ? (after - before) * 100.0 / before : 0;
+}
+
+// Compare this run against a summary saved from another build
+static void print_deltas(const CommandSummary baseline[TRACE_COMMAND_COUNT],
+                         const CommandSummary current[TRACE_COMMAND_COUNT])
+{
+    printf("\nChange vs baseline (negative latency / positive throughput is better):\n");
+    printf("%-10s %10s %10s %10s %10s\n", "COMMAND", "MEAN", "P95", "P99", "MiB/s");
+    for (int command = TRACE_CONNECT; command < TRACE_COMMAND_COUNT; command++)
+    {
+        const CommandSummary *b = &baseline[command], *c = &current[command];
+        if (b->count == 0 || c->count == 0)
+            continue;
+        printf("%-10s %+9.1f%% %+9.1f%% %+9.1f%%", trace_command_name(command),
+               percent_change(b->mean_us, c->mean_us), percent_change(b->p95_us, c->p95_us),
+               percent_change(b->p99_us, c->p99_us));
+        if (b->bytes > 0)
+            printf(" %+9.1f%%", percent_change(throughput_mib(b), throughput_mib(c)));
+        printf("\n");
+    }
+}
+
+static void dump_trace(void)
+{
+    printf("%12s %8s %-10s %10s %12s %10s %s\n", "TIME ms", "SESSION", "COMMAND", "FILE",
+           "BYTES", "DUR ms", "STATUS");
+    for (size_t i = 0; i < record_count; i++)
+    {
+        const TraceRecord *r = &records[i];
+        printf("%12.3f %8u %-10s %08x %12llu %10.3f %s%s\n", r->timestamp_us / 1000.0,
+               r->session, trace_command_name(r->command), r->file_id,
+               (unsigned long long)r->bytes, r->duration_us / 1000.0,
+               r->status ? "error" : "ok", r->flags & TRACE_FLAG_ADMIN ? " (admin)" : "");
+    }
+}
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [-s <speed>] [-o <summary>] [-b <baseline summary>] <trace>\n"
+            "       %s -d <trace>\n"
+            "  -s  replay speed multiplier, 0 replays as fast as possible (default 1)\n"
+            "  -o  save the results for a later -b comparison\n"
+            "  -b  report latency and throughput deltas against a saved run\n"
+            "  -d  print the trace records and exit\n",
+            program, program);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output_path = NULL;
+    const char *baseline_path = NULL;
+    int dump = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:o:b:d")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            speed = atof(optarg);
+            break;
+        case 'o':
+            output_path = optarg;
+            break;
+        case 'b':
+            baseline_path = optarg;
+            break;
+        case 'd':
+            dump = 1;
+            break;
+        default:
+            print_usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc - 1 || speed < 0)
+    {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (load_trace(argv[optind]) < 0)
+        exit(EXIT_FAILURE);
+
+    if (dump)
+    {
+        dump_trace();
+        free(records);
+        return 0;
+    }
+
+    // Group records into sessions
+    Session *sessions = NULL;
+    size_t session_count = 0;
+    IdTable session_ids;
+    results = calloc(record_count ? record_count : 1, sizeof(ReplayResult));
+    if (!results || id_table_init(&session_ids, record_count) < 0)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < record_count; i++)
+    {
+        size_t *slot = id_table_slot(&session_ids, records[i].session);
+        if (*slot == 0)
+        {
+            Session *grown = realloc(sessions, (session_count + 1) * sizeof(Session));
+            if (!grown)
+            {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+            sessions = grown;
+            memset(&sessions[session_count], 0, sizeof(Session));
+            sessions[session_count].session = records[i].session;
+            sessions[session_count].sock = -1;
+            *slot = ++session_count;
+        }
+
+        Session *session = &sessions[*slot - 1];
+        if (session->count == session->capacity)
+        {
+            size_t capacity = session->capacity ? session->capacity * 2 : 16;
+            size_t *grown = realloc(session->events, capacity * sizeof(size_t));
+            if (!grown)
+            {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+            session->events = grown;
+            session->capacity = capacity;
+        }
+        session->events[session->count++] = i;
+    }
+    id_table_free(&session_ids);
+
+    if (link_dependencies() < 0)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(payload, 'x', sizeof(payload));
+    printf("Replaying %zu command(s) from %zu session(s) at %s\n", record_count,
+           session_count, speed > 0 ? "traced pace" : "full speed");
+    if (speed > 0 && speed != 1)
+        printf("Speed multiplier: %.2fx\n", speed);
+
+    if (prepare_files() < 0)
+        exit(EXIT_FAILURE);
+
+    pthread_t *threads = malloc((session_count ? session_count : 1) * sizeof(pthread_t));
+    if (!threads)
+    {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    replay_start_us = now_us();
+    for (size_t s = 0; s < session_count; s++)
+    {
+        int error = pthread_create(&threads[s], NULL, session_thread, &sessions[s]);
+        if (error != 0)
+        {
+            // Sessions already running may be waiting on this one's records
+            fprintf(stderr, "Error: Cannot start session thread: %s\n", strerror(error));
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (size_t s = 0; s < session_count; s++)
+        pthread_join(threads[s], NULL);
+    double elapsed = (now_us() - replay_start_us) / 1e6;
+
+    // Commands whose outcome differs from the trace usually mean the replay diverged
+    unsigned long mismatches = 0, unreplayable = 0, rejected_sessions = 0, not_replayed = 0;
+    for (size_t i = 0; i < record_count; i++)
+    {
+        if (results[i].rejected)
+            not_replayed++;
+        else if (results[i].skipped)
+            unreplayable++;
+        else if (results[i].status != records[i].status)
+            mismatches++;
+    }
+    for (size_t s = 0; s < session_count; s++)
+    {
+        if (results[sessions[s].events[0]].rejected)
+            rejected_sessions++;
+    }
+
+    CommandSummary summary[TRACE_COMMAND_COUNT];
+    summarize(summary);
+    print_summary(summary);
+    printf("\nWall time: %.2fs, outcome mismatches vs trace: %lu\n", elapsed, mismatches);
+    if (rejected_sessions > 0)
+        printf("Connect rejections: %lu session(s), %lu command(s) not replayed\n",
+               rejected_sessions, not_replayed);
+    if (unreplayable > 0)
+        printf("Skipped %lu admin command(s) whose session admin rights differ from the trace\n",
+               unreplayable);
+
+    if (baseline_path)
+    {
+        CommandSummary baseline[TRACE_COMMAND_COUNT];
+        if (load_summary(baseline_path, baseline) == 0)
+            print_deltas(baseline, summary);
+    }
+    if (output_path)
+        save_summary(output_path, summary);
+
+    for (size_t s = 0; s < session_count; s++)
+        free(sessions[s].events);
+    free(sessions);
+    free(threads);
+    free(results);
+    free(records);
+    return 0;
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,8 +7,12 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <errno.h>
 
+#include "io_policy.h"
+#include "trace.h"
+
 #define PORT 8080
 #define BUFFER_SIZE 1024
 #define FILE_DIRECTORY "./server_files"
@@ -145,62 +150,91 @@ void list_files(int client_socket)
     closedir(dir);
 }
 
-// Handle file upload from client
-void handle_upload(int client_socket, const char *filename)
+// Handle file upload from client, returns bytes stored or -1 on error
+long long handle_upload(int client_socket, const char *filename)
 {
     char filepath[BUFFER_SIZE];
-    char buffer[BUFFER_SIZE];
+    IoStream stream;
     snprintf(filepath, sizeof(filepath), "%s/%s", FILE_DIRECTORY, filename);
 
-    int file_fd = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (file_fd < 0)
+    if (io_stream_open_write(&stream, filepath, filename) < 0)
     {
         send(client_socket, "ERROR: Cannot create file\n", 25, 0);
-        return;
+        return -1;
     }
 
     send(client_socket, "READY_FOR_UPLOAD\n", 17, 0);
 
+    // Receive straight into the stream's buffer, which is larger for uploads
+    // that may cross the large-file threshold. Hold back a marker-sized tail
+    // so an end marker split across reads, or sent in the same segment as
+    // file data, is still found.
+    char *buffer = stream.buffer;
+    const size_t marker_len = strlen("END_OF_UPLOAD");
+    size_t pending = 0;
     while (1)
     {
-        ssize_t bytes_read = recv(client_socket, buffer, sizeof(buffer), 0);
+        ssize_t bytes_read = recv(client_socket, buffer + pending,
+                                  stream.buffer_size - pending, 0);
         if (bytes_read <= 0)
         {
+            io_stream_write(&stream, buffer, pending);
             break;
         }
-        if (strstr(buffer, "END_OF_UPLOAD") != NULL)
+        pending += bytes_read;
+
+        char *end_marker = memmem(buffer, pending, "END_OF_UPLOAD", marker_len);
+        if (end_marker != NULL)
+        {
+            io_stream_write(&stream, buffer, end_marker - buffer);
             break;
-        write(file_fd, buffer, bytes_read);
+        }
+
+        size_t writable = pending > marker_len - 1 ? pending - (marker_len - 1) : 0;
+        io_stream_write(&stream, buffer, writable);
+        memmove(buffer, buffer + writable, pending - writable);
+        pending -= writable;
     }
 
-    close(file_fd);
+    io_stream_close(&stream);
     send(client_socket, "File uploaded successfully\n", 28, 0);
     printf("[INFO] File upload completed: %s\n", filename);
+    return stream.offset;
 }
 
-// Handle file download to client
-void handle_download(int client_socket, const char *filename)
+// Handle file download to client, returns bytes read or -1 on error
+long long handle_download(int client_socket, const char *filename)
 {
     char filepath[BUFFER_SIZE];
-    char buffer[BUFFER_SIZE];
+    IoStream stream;
     ssize_t bytes_read;
 
     snprintf(filepath, sizeof(filepath), "%s/%s", FILE_DIRECTORY, filename);
-    int file_fd = open(filepath, O_RDONLY);
-    if (file_fd < 0)
+    if (io_stream_open_read(&stream, filepath, filename) < 0)
     {
         send(client_socket, "ERROR: File not found\n", 21, 0);
-        return;
+        return -1;
     }
 
-    while ((bytes_read = read(file_fd, buffer, sizeof(buffer))) > 0)
+    // Large streams use bigger buffers, so send() may need several calls
+    while ((bytes_read = io_stream_read(&stream)) > 0)
     {
-        send(client_socket, buffer, bytes_read, 0);
+        ssize_t sent = 0;
+        while (sent < bytes_read)
+        {
+            ssize_t result = send(client_socket, stream.buffer + sent, bytes_read - sent, 0);
+            if (result <= 0)
+                break;
+            sent += result;
+        }
+        if (sent < bytes_read)
+            break;
     }
 
-    close(file_fd);
+    io_stream_close(&stream);
     send(client_socket, "END_OF_FILE\n", 12, 0);
     printf("[INFO] File download completed: %s\n", filename);
+    return stream.offset;
 }
 
 // Main client handler - processes all client commands
@@ -209,6 +243,7 @@ void handle_client(int client_socket, int uid)
     char buffer[BUFFER_SIZE];
     ssize_t bytes_read;
     int is_admin = (client_count == 1);
+    uint64_t started = trace_now_us();
 
     for (int i = 0; i < MAX_CLIENTS; i++)
     {
@@ -262,18 +297,29 @@ void handle_client(int client_socket, int uid)
         }
     }
 
+    trace_record(uid, TRACE_CONNECT, started, 0, 0, 0, 1, is_admin);
+
     // Process client commands
     while ((bytes_read = recv(client_socket, buffer, sizeof(buffer) - 1, 0)) > 0)
     {
         buffer[bytes_read] = '\0';
 
+        // Trace fields, filled in by the command handlers below
+        TraceCommand command = TRACE_INVALID;
+        long long bytes = 0;
+        uint32_t file_id = 0, aux_id = 0;
+        int ok = 1;
+        started = trace_now_us();
+
         // Check if client is admin
         int current_is_admin = 0;
+        const char *current_username = "";
         for (int i = 0; i < MAX_CLIENTS; i++)
         {
             if (clients[i].uid == uid)
             {
                 current_is_admin = clients[i].is_admin;
+                current_username = clients[i].username;
                 break;
             }
         }
@@ -281,40 +327,52 @@ void handle_client(int client_socket, int uid)
         // Handle different commands
         if (strncmp(buffer, "LIST", 4) == 0)
         {
+            command = TRACE_LIST;
             list_files(client_socket);
         }
         // File operations
         else if (strncmp(buffer, "UPLOAD", 6) == 0)
         {
-            handle_upload(client_socket, buffer + 7);
+            command = TRACE_UPLOAD;
+            file_id = trace_file_id(buffer + 7);
+            bytes = handle_upload(client_socket, buffer + 7);
         }
         else if (strncmp(buffer, "DOWNLOAD", 8) == 0)
         {
-            handle_download(client_socket, buffer + 9);
+            command = TRACE_DOWNLOAD;
+            file_id = trace_file_id(buffer + 9);
+            bytes = handle_download(client_socket, buffer + 9);
         }
         // Admin operations
         else if (current_is_admin && strncmp(buffer, "DELETE", 6) == 0)
         {
             char filepath[BUFFER_SIZE];
             char *filename = buffer + 7;
+            command = TRACE_DELETE;
+            file_id = trace_file_id(filename);
             snprintf(filepath, sizeof(filepath), "%s/%s", FILE_DIRECTORY, filename);
             if (remove(filepath) == 0)
             {
                 send(client_socket, "File deleted successfully\n", 27, 0);
                 printf("[INFO] File deleted by admin %s: %s\n",
-                       clients[uid].username, filename);
+                       current_username, filename);
             }
             else
             {
                 send(client_socket, "ERROR: Cannot delete file\n", 28, 0);
+                ok = 0;
             }
         }
         else if (current_is_admin && strncmp(buffer, "RENAME", 6) == 0)
         {
             char *old_name = strtok(buffer + 7, " ");
             char *new_name = strtok(NULL, " \n");
+            command = TRACE_RENAME;
+            ok = 0;
             if (old_name && new_name)
             {
+                file_id = trace_file_id(old_name);
+                aux_id = trace_file_id(new_name);
                 char old_path[BUFFER_SIZE], new_path[BUFFER_SIZE];
                 snprintf(old_path, sizeof(old_path), "%s/%s",
                          FILE_DIRECTORY, old_name);
@@ -323,8 +381,9 @@ void handle_client(int client_socket, int uid)
                 if (rename(old_path, new_path) == 0)
                 {
                     send(client_socket, "File renamed successfully\n\n", 28, 0);
+                    ok = 1;
                     printf("[INFO] File renamed by admin %s: %s -> %s\n",
-                           clients[uid].username, old_name, new_name);
+                           current_username, old_name, new_name);
                 }
                 else
                 {
@@ -343,18 +402,73 @@ void handle_client(int client_socket, int uid)
         else
         {
             send(client_socket, "ERROR: Invalid command\n", 24, 0);
+            ok = 0;
+
+            // Keep rejected admin commands recognisable in the trace
+            if (strncmp(buffer, "DELETE", 6) == 0)
+                command = TRACE_DELETE;
+            else if (strncmp(buffer, "RENAME", 6) == 0)
+                command = TRACE_RENAME;
         }
+
+        if (bytes < 0)
+        {
+            bytes = 0;
+            ok = 0;
+        }
+        trace_record(uid, command, started, bytes, file_id, aux_id, ok, current_is_admin);
     }
 
+    trace_record(uid, TRACE_DISCONNECT, trace_now_us(), 0, 0, 0, 1, is_admin);
     remove_client(uid);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
     int server_socket, client_socket;
     struct sockaddr_in server_addr, client_addr;
     socklen_t client_len = sizeof(client_addr);
     int uid = 0;
+    int opt;
+
+    // Large-file I/O policy: -t <size> sets the default threshold,
+    // -p [<prefix>=]<cached|stream|direct>[:<size>] adds a rule.
+    // -T <file> records every command to a binary trace for ./replay.
+    while ((opt = getopt(argc, argv, "t:p:T:")) != -1)
+    {
+        size_t threshold;
+        if (opt == 't' && io_parse_size(optarg, &threshold) == 0)
+        {
+            io_policy_set_threshold(threshold);
+        }
+        else if (opt == 'p' && io_policy_add_rule(optarg) == 0)
+        {
+            continue;
+        }
+        else if (opt == 'T')
+        {
+            if (trace_open(optarg) < 0)
+            {
+                perror("Cannot open trace file");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-t <size>] [-p [<prefix>=]<cached|stream|direct>[:<size>]]... [-T <trace>]\n",
+                    argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Line-buffer the log so forked children don't repeat unflushed output
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    if (io_policy_init() < 0)
+    {
+        perror("I/O stats allocation failed");
+        exit(EXIT_FAILURE);
+    }
 
     // Clear client array on startup
     for (int i = 0; i < MAX_CLIENTS; i++)
@@ -374,7 +488,7 @@ int main()
         exit(EXIT_FAILURE);
     }
 
-    int opt = 1;
+    opt = 1;
     if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
     {
         perror("Setsockopt failed");
@@ -398,6 +512,7 @@ int main()
     }
 
     printf("Server started on port %d...\n", PORT);
+    io_policy_print();
 
     // Main server loop - accept new connections
     while (1)
@@ -409,6 +524,12 @@ int main()
             continue;
         }
 
+        // Reap finished client processes so their slots can be reused
+        while (waitpid(-1, NULL, WNOHANG) > 0)
+        {
+            client_count--;
+        }
+
         if (client_count >= MAX_CLIENTS)
         {
             send(client_socket, "Server is full\n", 15, 0);
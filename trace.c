@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "trace.h"
+
+static int trace_fd = -1;
+static uint64_t trace_start_us = 0;
+
+static uint64_t clock_us(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+int trace_open(const char *path)
+{
+    // O_APPEND keeps each record write atomic across forked clients
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (trace_fd < 0)
+        return -1;
+
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    header.start_epoch_us = clock_us(CLOCK_REALTIME);
+    trace_start_us = clock_us(CLOCK_MONOTONIC);
+
+    if (write(trace_fd, &header, sizeof(header)) != sizeof(header))
+    {
+        close(trace_fd);
+        trace_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int trace_enabled(void)
+{
+    return trace_fd >= 0;
+}
+
+uint64_t trace_now_us(void)
+{
+    return clock_us(CLOCK_MONOTONIC);
+}
+
+// FNV-1a, so replays can tell files apart without knowing their names
+uint32_t trace_file_id(const char *filename)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)filename; *p && *p != '\n'; p++)
+    {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void trace_record(uint32_t session, TraceCommand command, uint64_t started_us,
+                  uint64_t bytes, uint32_t file_id, uint32_t aux_id, int ok, int is_admin)
+{
+    if (trace_fd < 0)
+        return;
+
+    TraceRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestamp_us = started_us - trace_start_us;
+    record.duration_us = (uint32_t)(trace_now_us() - started_us);
+    record.bytes = bytes;
+    record.session = session;
+    record.file_id = file_id;
+    record.aux_id = aux_id;
+    record.command = command;
+    record.status = ok ? 0 : 1;
+    record.flags = is_admin ? TRACE_FLAG_ADMIN : 0;
+
+    if (write(trace_fd, &record, sizeof(record)) != sizeof(record))
+    {
+        perror("Trace write failed");
+    }
+}
+
+int trace_read_header(FILE *file, TraceHeader *header)
+{
+    if (fread(header, sizeof(*header), 1, file) != 1)
+        return -1;
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != TRACE_VERSION || header->record_size != sizeof(TraceRecord))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+const char *trace_command_name(int command)
+{
+    switch (command)
+    {
+    case TRACE_CONNECT:
+        return "CONNECT";
+    case TRACE_LIST:
+        return "LIST";
+    case TRACE_UPLOAD:
+        return "UPLOAD";
+    case TRACE_DOWNLOAD:
+        return "DOWNLOAD";
+    case TRACE_DELETE:
+        return "DELETE";
+    case TRACE_RENAME:
+        return "RENAME";
+    case TRACE_INVALID:
+        return "INVALID";
+    case TRACE_DISCONNECT:
+        return "DISCONNECT";
+    }
+    return "UNKNOWN";
+}
@@ -0,0 +1,64 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_MAGIC "FSTRACE1"
+#define TRACE_VERSION 1
+
+// TraceRecord.flags
+#define TRACE_FLAG_ADMIN 0x01 // Session had admin rights
+
+// Commands seen by handle_client(). Values are stored in trace files.
+typedef enum
+{
+    TRACE_CONNECT = 1,
+    TRACE_LIST,
+    TRACE_UPLOAD,
+    TRACE_DOWNLOAD,
+    TRACE_DELETE,
+    TRACE_RENAME,
+    TRACE_INVALID,
+    TRACE_DISCONNECT,
+    TRACE_COMMAND_COUNT
+} TraceCommand;
+
+// File header, followed by fixed-size records in host byte order
+typedef struct __attribute__((packed))
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t start_epoch_us;
+} TraceHeader;
+
+// One command. Filenames are replaced by hashes and no contents are kept.
+typedef struct __attribute__((packed))
+{
+    uint64_t timestamp_us; // Since the trace was opened
+    uint64_t bytes;        // File bytes moved by the command
+    uint32_t duration_us;
+    uint32_t session;      // Client UID
+    uint32_t file_id;
+    uint32_t aux_id;       // RENAME target
+    uint8_t command;
+    uint8_t status;        // 0 on success
+    uint8_t flags;
+    uint8_t reserved;
+} TraceRecord;
+
+// Called once in the server before fork(). Truncates an existing trace.
+int trace_open(const char *path);
+int trace_enabled(void);
+uint64_t trace_now_us(void);
+uint32_t trace_file_id(const char *filename);
+
+// Append one record. started_us comes from trace_now_us().
+void trace_record(uint32_t session, TraceCommand command, uint64_t started_us,
+                  uint64_t bytes, uint32_t file_id, uint32_t aux_id, int ok, int is_admin);
+
+int trace_read_header(FILE *file, TraceHeader *header);
+const char *trace_command_name(int command);
+
+#endif
@@ -0,0 +1,650 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+
+#include "transfer.h"
+
+#define UPLOAD_MARKER "END_OF_UPLOAD"
+#define DOWNLOAD_MARKER "END_OF_FILE"
+#define RATE_SAMPLE_SECONDS 0.5
+
+static double elapsed_seconds(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+static int is_finished(const Transfer *t)
+{
+    return t->state == TRANSFER_DONE || t->state == TRANSFER_FAILED;
+}
+
+static int is_active(const Transfer *t)
+{
+    return t->state != TRANSFER_QUEUED && !is_finished(t);
+}
+
+const char *transfer_state_name(TransferState state)
+{
+    switch (state)
+    {
+    case TRANSFER_QUEUED:
+        return "queued";
+    case TRANSFER_CONNECTING:
+    case TRANSFER_SEND_HELLO:
+    case TRANSFER_AWAIT_WELCOME:
+    case TRANSFER_SEND_COMMAND:
+    case TRANSFER_AWAIT_READY:
+        return "starting";
+    case TRANSFER_SEND_DATA:
+    case TRANSFER_RECEIVE_DATA:
+        return "running";
+    case TRANSFER_SEND_TRAILER:
+    case TRANSFER_AWAIT_RESULT:
+        return "finishing";
+    case TRANSFER_DONE:
+        return "done";
+    case TRANSFER_FAILED:
+        return "failed";
+    }
+    return "unknown";
+}
+
+int transfer_engine_init(TransferEngine *engine, const char *host, int port,
+                         const char *username, int max_active)
+{
+    memset(engine, 0, sizeof(*engine));
+    engine->max_active = max_active > 0 ? max_active : TRANSFER_DEFAULT_ACTIVE;
+    strncpy(engine->username, username, sizeof(engine->username) - 1);
+
+    engine->server_addr.sin_family = AF_INET;
+    engine->server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &engine->server_addr.sin_addr) <= 0)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+void transfer_engine_destroy(TransferEngine *engine)
+{
+    for (int i = 0; i < engine->count; i++)
+    {
+        Transfer *t = &engine->transfers[i];
+        if (t->sock >= 0)
+            close(t->sock);
+        if (t->file_fd >= 0)
+            close(t->file_fd);
+    }
+    free(engine->transfers);
+    engine->transfers = NULL;
+    engine->count = 0;
+    engine->capacity = 0;
+}
+
+int transfer_submit(TransferEngine *engine, TransferType type, const char *filename)
+{
+    if (strlen(filename) == 0 || strlen(filename) >= sizeof(engine->transfers[0].filename))
+    {
+        return -1;
+    }
+
+    if (engine->count == engine->capacity)
+    {
+        int new_capacity = engine->capacity ? engine->capacity * 2 : 8;
+        Transfer *grown = realloc(engine->transfers, new_capacity * sizeof(Transfer));
+        if (!grown)
+        {
+            return -1;
+        }
+        engine->transfers = grown;
+        engine->capacity = new_capacity;
+    }
+
+    Transfer *t = &engine->transfers[engine->count];
+    memset(t, 0, sizeof(*t));
+    t->id = engine->count + 1;
+    t->type = type;
+    t->state = TRANSFER_QUEUED;
+    t->sock = -1;
+    t->file_fd = -1;
+    strncpy(t->filename, filename, sizeof(t->filename) - 1);
+    engine->count++;
+    return t->id;
+}
+
+// Move a transfer into a terminal state and release its descriptors
+static void finish_transfer(TransferEngine *engine, Transfer *t, TransferState state,
+                            const char *message)
+{
+    if (t->sock >= 0)
+    {
+        // Best effort: let the server close its side cleanly
+        if (state == TRANSFER_DONE)
+            send(t->sock, "EXIT", 4, MSG_NOSIGNAL);
+        close(t->sock);
+        t->sock = -1;
+    }
+    if (t->file_fd >= 0)
+    {
+        close(t->file_fd);
+        t->file_fd = -1;
+    }
+    if (state == TRANSFER_FAILED && t->type == TRANSFER_DOWNLOAD)
+    {
+        remove(t->filename);
+    }
+
+    t->state = state;
+    clock_gettime(CLOCK_MONOTONIC, &t->finished);
+    if (message)
+    {
+        snprintf(t->message, sizeof(t->message), "%s", message);
+        t->message[strcspn(t->message, "\n")] = '\0';
+    }
+
+    if (engine->on_complete)
+        engine->on_complete(t, engine->ctx);
+}
+
+static void fail_errno(TransferEngine *engine, Transfer *t, const char *what)
+{
+    char message[128];
+    snprintf(message, sizeof(message), "%s: %s", what, strerror(errno));
+    finish_transfer(engine, t, TRANSFER_FAILED, message);
+}
+
+// Open the local file and start a non-blocking connect
+static void start_transfer(TransferEngine *engine, Transfer *t)
+{
+    clock_gettime(CLOCK_MONOTONIC, &t->started);
+    t->sample_time = t->started;
+
+    if (t->type == TRANSFER_UPLOAD)
+    {
+        struct stat file_stat;
+        t->file_fd = open(t->filename, O_RDONLY);
+        if (t->file_fd < 0)
+        {
+            fail_errno(engine, t, "Cannot open file");
+            return;
+        }
+        if (fstat(t->file_fd, &file_stat) == 0)
+            t->total_size = file_stat.st_size;
+    }
+    else
+    {
+        t->file_fd = open(t->filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (t->file_fd < 0)
+        {
+            fail_errno(engine, t, "Cannot create file");
+            return;
+        }
+    }
+
+    t->sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (t->sock < 0)
+    {
+        fail_errno(engine, t, "Socket creation failed");
+        return;
+    }
+    fcntl(t->sock, F_SETFL, fcntl(t->sock, F_GETFL) | O_NONBLOCK);
+
+    t->buf_len = snprintf(t->buffer, sizeof(t->buffer), "USERNAME %s", engine->username);
+    t->buf_off = 0;
+
+    if (connect(t->sock, (struct sockaddr *)&engine->server_addr,
+                sizeof(engine->server_addr)) == 0)
+    {
+        t->state = TRANSFER_SEND_HELLO;
+    }
+    else if (errno == EINPROGRESS)
+    {
+        t->state = TRANSFER_CONNECTING;
+    }
+    else
+    {
+        fail_errno(engine, t, "Connection failed");
+    }
+}
+
+// Send what is left in the buffer. Returns 1 when drained, 0 on EAGAIN, -1 on error.
+static int flush_buffer(Transfer *t)
+{
+    while (t->buf_off < t->buf_len)
+    {
+        ssize_t sent = send(t->sock, t->buffer + t->buf_off, t->buf_len - t->buf_off,
+                            MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                return 0;
+            return -1;
+        }
+        t->buf_off += sent;
+    }
+    t->buf_len = 0;
+    t->buf_off = 0;
+    return 1;
+}
+
+// Accumulate a server reply. Returns 1 once a full line (or an ERROR) has
+// arrived, 0 if more data is needed, -1 on error or disconnect.
+static int read_reply(Transfer *t)
+{
+    ssize_t received = recv(t->sock, t->buffer + t->buf_len,
+                            sizeof(t->buffer) - t->buf_len - 1, 0);
+    if (received < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    if (received == 0)
+        return -1;
+
+    t->buf_len += received;
+    t->buffer[t->buf_len] = '\0';
+    if (strchr(t->buffer, '\n') || strncmp(t->buffer, "ERROR", 5) == 0 ||
+        t->buf_len == sizeof(t->buffer) - 1)
+    {
+        return 1;
+    }
+    return 0;
+}
+
+static void queue_command(Transfer *t)
+{
+    const char *verb = t->type == TRANSFER_UPLOAD ? "UPLOAD" : "DOWNLOAD";
+    t->buf_len = snprintf(t->buffer, sizeof(t->buffer), "%s %s", verb, t->filename);
+    t->buf_off = 0;
+    t->state = TRANSFER_SEND_COMMAND;
+}
+
+static void update_rate(Transfer *t)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double dt = elapsed_seconds(&t->sample_time, &now);
+    if (dt >= RATE_SAMPLE_SECONDS)
+    {
+        t->rate = (t->bytes_done - t->sample_bytes) / dt;
+        t->sample_bytes = t->bytes_done;
+        t->sample_time = now;
+    }
+}
+
+// Stream file contents to the server, then the end marker
+static void send_data(TransferEngine *engine, Transfer *t)
+{
+    while (1)
+    {
+        if (t->buf_len == 0)
+        {
+            ssize_t bytes_read = read(t->file_fd, t->buffer, sizeof(t->buffer));
+            if (bytes_read < 0)
+            {
+                fail_errno(engine, t, "Read failed");
+                return;
+            }
+            if (bytes_read == 0)
+            {
+                t->buf_len = strlen(UPLOAD_MARKER);
+                memcpy(t->buffer, UPLOAD_MARKER, t->buf_len);
+                t->buf_off = 0;
+                t->state = TRANSFER_SEND_TRAILER;
+                return;
+            }
+            t->buf_len = bytes_read;
+            t->buf_off = 0;
+        }
+
+        size_t remaining = t->buf_len - t->buf_off;
+        int result = flush_buffer(t);
+        t->bytes_done += remaining - (t->buf_len - t->buf_off);
+        if (result < 0)
+        {
+            fail_errno(engine, t, "Send failed");
+            return;
+        }
+        if (result == 0)
+            break;
+    }
+    update_rate(t);
+}
+
+// Receive file contents, holding back enough bytes to spot a split end marker
+static void receive_data(TransferEngine *engine, Transfer *t)
+{
+    const size_t marker_len = strlen(DOWNLOAD_MARKER);
+
+    ssize_t received = recv(t->sock, t->buffer + t->buf_len,
+                            sizeof(t->buffer) - t->buf_len, 0);
+    if (received < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            fail_errno(engine, t, "Receive failed");
+        return;
+    }
+    if (received == 0)
+    {
+        finish_transfer(engine, t, TRANSFER_FAILED, "Connection closed by server");
+        return;
+    }
+    t->buf_len += received;
+
+    if (t->bytes_done == 0 && t->buf_len >= 6 && strncmp(t->buffer, "ERROR:", 6) == 0)
+    {
+        char message[128];
+        size_t len = t->buf_len < sizeof(message) - 1 ? t->buf_len : sizeof(message) - 1;
+        memcpy(message, t->buffer, len);
+        message[len] = '\0';
+        finish_transfer(engine, t, TRANSFER_FAILED, message);
+        return;
+    }
+
+    char *end_marker = memmem(t->buffer, t->buf_len, DOWNLOAD_MARKER, marker_len);
+    size_t writable = end_marker ? (size_t)(end_marker - t->buffer)
+                                 : (t->buf_len > marker_len - 1 ? t->buf_len - (marker_len - 1) : 0);
+
+    if (writable > 0 && write(t->file_fd, t->buffer, writable) != (ssize_t)writable)
+    {
+        fail_errno(engine, t, "Write failed");
+        return;
+    }
+    t->bytes_done += writable;
+
+    if (end_marker)
+    {
+        char message[128];
+        snprintf(message, sizeof(message), "Downloaded %zu bytes", t->bytes_done);
+        finish_transfer(engine, t, TRANSFER_DONE, message);
+        return;
+    }
+
+    memmove(t->buffer, t->buffer + writable, t->buf_len - writable);
+    t->buf_len -= writable;
+    update_rate(t);
+}
+
+// Advance a single transfer after poll() reported activity on its socket
+static void process_transfer(TransferEngine *engine, Transfer *t, short revents)
+{
+    int result;
+
+    if (revents & POLLNVAL)
+    {
+        finish_transfer(engine, t, TRANSFER_FAILED, "Invalid socket");
+        return;
+    }
+
+    switch (t->state)
+    {
+    case TRANSFER_CONNECTING:
+    {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(t->sock, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0)
+        {
+            errno = err;
+            fail_errno(engine, t, "Connection failed");
+            return;
+        }
+        t->state = TRANSFER_SEND_HELLO;
+    }
+    // fall through
+    case TRANSFER_SEND_HELLO:
+        result = flush_buffer(t);
+        if (result < 0)
+            fail_errno(engine, t, "Send failed");
+        else if (result == 1)
+            t->state = TRANSFER_AWAIT_WELCOME;
+        break;
+
+    case TRANSFER_AWAIT_WELCOME:
+        result = read_reply(t);
+        if (result < 0)
+            finish_transfer(engine, t, TRANSFER_FAILED, "Server closed connection");
+        else if (result == 1 && strncmp(t->buffer, "Welcome", 7) != 0)
+            finish_transfer(engine, t, TRANSFER_FAILED, t->buffer);
+        else if (result == 1)
+            queue_command(t);
+        break;
+
+    case TRANSFER_SEND_COMMAND:
+        result = flush_buffer(t);
+        if (result < 0)
+            fail_errno(engine, t, "Send failed");
+        else if (result == 1)
+            t->state = t->type == TRANSFER_UPLOAD ? TRANSFER_AWAIT_READY
+                                                  : TRANSFER_RECEIVE_DATA;
+        break;
+
+    case TRANSFER_AWAIT_READY:
+        result = read_reply(t);
+        if (result < 0)
+        {
+            finish_transfer(engine, t, TRANSFER_FAILED, "Server closed connection");
+        }
+        else if (result == 1)
+        {
+            if (strstr(t->buffer, "READY_FOR_UPLOAD") == NULL)
+            {
+                finish_transfer(engine, t, TRANSFER_FAILED, t->buffer);
+                return;
+            }
+            t->buf_len = 0;
+            t->buf_off = 0;
+            t->state = TRANSFER_SEND_DATA;
+            clock_gettime(CLOCK_MONOTONIC, &t->sample_time);
+        }
+        break;
+
+    case TRANSFER_SEND_DATA:
+        send_data(engine, t);
+        break;
+
+    case TRANSFER_SEND_TRAILER:
+        result = flush_buffer(t);
+        if (result < 0)
+            fail_errno(engine, t, "Send failed");
+        else if (result == 1)
+            t->state = TRANSFER_AWAIT_RESULT;
+        break;
+
+    case TRANSFER_AWAIT_RESULT:
+        result = read_reply(t);
+        if (result < 0)
+            finish_transfer(engine, t, TRANSFER_FAILED, "Server closed connection");
+        else if (result == 1)
+            finish_transfer(engine, t,
+                            strncmp(t->buffer, "ERROR", 5) == 0 ? TRANSFER_FAILED
+                                                                : TRANSFER_DONE,
+                            t->buffer);
+        break;
+
+    case TRANSFER_RECEIVE_DATA:
+        receive_data(engine, t);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static short wanted_events(const Transfer *t)
+{
+    switch (t->state)
+    {
+    case TRANSFER_CONNECTING:
+    case TRANSFER_SEND_HELLO:
+    case TRANSFER_SEND_COMMAND:
+    case TRANSFER_SEND_DATA:
+    case TRANSFER_SEND_TRAILER:
+        return POLLOUT;
+    default:
+        return POLLIN;
+    }
+}
+
+int transfer_engine_step(TransferEngine *engine, const int *watch_fds, int watch_count,
+                         int timeout_ms)
+{
+    // Promote queued transfers while there is room
+    int active = 0;
+    for (int i = 0; i < engine->count; i++)
+    {
+        if (is_active(&engine->transfers[i]))
+            active++;
+    }
+    for (int i = 0; i < engine->count && active < engine->max_active; i++)
+    {
+        Transfer *t = &engine->transfers[i];
+        if (t->state == TRANSFER_QUEUED)
+        {
+            start_transfer(engine, t);
+            if (is_active(t))
+                active++;
+        }
+    }
+
+    struct pollfd *fds = malloc((active + watch_count) * sizeof(struct pollfd));
+    int *owners = malloc((active + watch_count) * sizeof(int));
+    if (!fds || !owners)
+    {
+        free(fds);
+        free(owners);
+        return 0;
+    }
+
+    int nfds = 0;
+    for (int i = 0; i < watch_count; i++)
+    {
+        if (watch_fds[i] < 0)
+            continue;
+        fds[nfds].fd = watch_fds[i];
+        fds[nfds].events = POLLIN;
+        owners[nfds] = -1 - i;
+        nfds++;
+    }
+    for (int i = 0; i < engine->count; i++)
+    {
+        Transfer *t = &engine->transfers[i];
+        if (is_active(t))
+        {
+            fds[nfds].fd = t->sock;
+            fds[nfds].events = wanted_events(t);
+            owners[nfds] = i;
+            nfds++;
+        }
+    }
+
+    int watch_ready = 0;
+    if (nfds > 0 && poll(fds, nfds, timeout_ms) > 0)
+    {
+        for (int i = 0; i < nfds; i++)
+        {
+            if (fds[i].revents == 0)
+                continue;
+            if (owners[i] < 0)
+                watch_ready |= 1 << (-1 - owners[i]);
+            else
+                process_transfer(engine, &engine->transfers[owners[i]], fds[i].revents);
+        }
+    }
+
+    free(fds);
+    free(owners);
+    return watch_ready;
+}
+
+int transfer_engine_pending(const TransferEngine *engine)
+{
+    int pending = 0;
+    for (int i = 0; i < engine->count; i++)
+    {
+        if (!is_finished(&engine->transfers[i]))
+            pending++;
+    }
+    return pending;
+}
+
+int transfer_engine_failed(const TransferEngine *engine)
+{
+    int failed = 0;
+    for (int i = 0; i < engine->count; i++)
+    {
+        if (engine->transfers[i].state == TRANSFER_FAILED)
+            failed++;
+    }
+    return failed;
+}
+
+static void format_bytes(double bytes, char *out, size_t size)
+{
+    const char *units[] = {"B", "KiB", "MiB", "GiB"};
+    int unit = 0;
+    while (bytes >= 1024 && unit < 3)
+    {
+        bytes /= 1024;
+        unit++;
+    }
+    snprintf(out, size, "%.1f %s", bytes, units[unit]);
+}
+
+// Print one line per transfer with progress and throughput. Percentage and
+// ETA are only shown for uploads, the protocol does not send download sizes.
+void transfer_print_status(const TransferEngine *engine, FILE *out, int active_only)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (int i = 0; i < engine->count; i++)
+    {
+        const Transfer *t = &engine->transfers[i];
+        if (active_only && !is_active(t))
+            continue;
+
+        char done[32], rate[32];
+        format_bytes(t->bytes_done, done, sizeof(done));
+
+        fprintf(out, "[#%d] %-8s %-24s %-9s %10s",
+                t->id, t->type == TRANSFER_UPLOAD ? "UPLOAD" : "DOWNLOAD",
+                t->filename, transfer_state_name(t->state), done);
+
+        if (t->state == TRANSFER_QUEUED)
+        {
+            fprintf(out, "\n");
+            continue;
+        }
+
+        if (is_finished(t))
+        {
+            double elapsed = elapsed_seconds(&t->started, &t->finished);
+            format_bytes(elapsed > 0 ? t->bytes_done / elapsed : 0, rate, sizeof(rate));
+            fprintf(out, "  avg %s/s  %.1fs  %s\n", rate, elapsed, t->message);
+            continue;
+        }
+
+        // The sampled rate only updates on socket activity, so let it decay
+        // once a stalled transfer's sample window has expired
+        double current_rate = t->rate;
+        double since_sample = elapsed_seconds(&t->sample_time, &now);
+        if (since_sample >= RATE_SAMPLE_SECONDS)
+            current_rate = (t->bytes_done - t->sample_bytes) / since_sample;
+
+        format_bytes(current_rate, rate, sizeof(rate));
+        fprintf(out, "  %s/s", rate);
+        if (t->total_size > 0)
+        {
+            fprintf(out, "  %3.0f%%", 100.0 * t->bytes_done / t->total_size);
+            if (current_rate > 0)
+                fprintf(out, "  ETA %.0fs", (t->total_size - t->bytes_done) / current_rate);
+        }
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#define TRANSFER_BUFFER_SIZE 8192
+#define TRANSFER_DEFAULT_ACTIVE 4
+
+typedef enum
+{
+    TRANSFER_UPLOAD,
+    TRANSFER_DOWNLOAD
+} TransferType;
+
+// Each transfer runs on its own connection and walks through these states
+typedef enum
+{
+    TRANSFER_QUEUED,
+    TRANSFER_CONNECTING,
+    TRANSFER_SEND_HELLO,
+    TRANSFER_AWAIT_WELCOME,
+    TRANSFER_SEND_COMMAND,
+    TRANSFER_AWAIT_READY,
+    TRANSFER_SEND_DATA,
+    TRANSFER_SEND_TRAILER,
+    TRANSFER_AWAIT_RESULT,
+    TRANSFER_RECEIVE_DATA,
+    TRANSFER_DONE,
+    TRANSFER_FAILED
+} TransferState;
+
+// A single background upload or download
+typedef struct
+{
+    int id;
+    TransferType type;
+    TransferState state;
+    char filename[256];
+    int sock;
+    int file_fd;
+    size_t total_size; // Only known for uploads, downloads get no ETA
+    size_t bytes_done;
+    struct timespec started;
+    struct timespec finished;
+    struct timespec sample_time;
+    size_t sample_bytes;
+    double rate; // Bytes per second over the last sample window
+    char buffer[TRANSFER_BUFFER_SIZE];
+    size_t buf_len;
+    size_t buf_off;
+    char message[128];
+} Transfer;
+
+// Called once when a transfer reaches TRANSFER_DONE or TRANSFER_FAILED
+typedef void (*TransferCallback)(const Transfer *transfer, void *ctx);
+
+// Queue of transfers driven by a single poll() loop
+typedef struct
+{
+    Transfer *transfers;
+    int count;
+    int capacity;
+    int max_active;
+    char username[50];
+    struct sockaddr_in server_addr;
+    TransferCallback on_complete;
+    void *ctx;
+} TransferEngine;
+
+int transfer_engine_init(TransferEngine *engine, const char *host, int port,
+                         const char *username, int max_active);
+void transfer_engine_destroy(TransferEngine *engine);
+
+// Queue a transfer, returns its id or -1 on error
+int transfer_submit(TransferEngine *engine, TransferType type, const char *filename);
+
+// Run one poll() round. Also watches the watch_count fds in watch_fds
+// (entries of -1 are skipped) and returns a mask with bit i set if
+// watch_fds[i] became readable.
+int transfer_engine_step(TransferEngine *engine, const int *watch_fds, int watch_count,
+                         int timeout_ms);
+
+// Number of transfers that are queued or in flight
+int transfer_engine_pending(const TransferEngine *engine);
+int transfer_engine_failed(const TransferEngine *engine);
+
+void transfer_print_status(const TransferEngine *engine, FILE *out, int active_only);
+const char *transfer_state_name(TransferState state);
+
+#endif